@@ -0,0 +1,54 @@
+#!/bin/bash
+# Scaling benchmark for the sharded deployment: runs the same workload
+# through ./router with 1..N engine shards and prints events/s for each.
+# Usage: ./bench_shards.sh [max shards] [clients] [orders per client]
+max_shards=${1:-4}
+clients=${2:-4}
+orders=${3:-50000}
+dir=$(mktemp -d)
+trap 'kill $(jobs -p) 2>/dev/null; rm -rf $dir' EXIT
+
+# Crossing buy/sell pairs of equal size spread over 16 instruments.
+for c in $(seq 1 $clients); do
+  awk -v c=$c -v n=$orders 'BEGIN {
+    for (i = 0; i < n; i += 2) {
+      id = c * 10000000 + i
+      printf "B %d SYM%d 100 10\nS %d SYM%d 100 10\n", id, i % 16, id + 1, i % 16
+    }
+  }' > $dir/client$c.input
+done
+
+for shards in $(seq 1 $max_shards); do
+  paths=""
+  for s in $(seq 1 $shards); do
+    ./engine $dir/shard$s.sock > $dir/shard$s.out 2>/dev/null &
+    paths="$paths $dir/shard$s.sock"
+  done
+  sleep 0.5
+  ./router $dir/router.sock $paths &
+  router=$!
+  sleep 0.2
+
+  client_pids=""
+  for c in $(seq 1 $clients); do
+    ./client $dir/router.sock < $dir/client$c.input 2>/dev/null &
+    client_pids="$client_pids $!"
+  done
+  wait $client_pids
+  sleep 1
+  kill $(jobs -p) 2>/dev/null
+  wait 2>/dev/null
+
+  # Timestamps share the CLOCK_MONOTONIC timeline across processes.
+  cat $dir/shard*.out | awk -v shards=$shards '
+    NF >= 5 {
+      events++
+      if (first == "" || $(NF - 1) < first) first = $(NF - 1)
+      if ($NF > last) last = $NF
+    }
+    END {
+      span = last - first
+      printf "%d shard(s): %d events in %d us, %.0f events/s\n", shards, events, span, events / span * 1000000
+    }'
+  rm -f $dir/*.sock $dir/*.out
+done
@@ -0,0 +1,86 @@
+#include "clock.hpp"
+
+#include <ctime>
+#if CLOCK_HAS_TSC
+#include <cpuid.h>
+
+static int64_t MonotonicNanoseconds() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// Pairs a TSC read with the midpoint of the monotonic reads around it,
+// which halves the skew between the two clocks.
+static void SampleClocks(int64_t& ns, int64_t& tsc) {
+  int64_t before = MonotonicNanoseconds();
+  tsc = static_cast<int64_t>(__rdtsc());
+  ns = (before + MonotonicNanoseconds()) / 2;
+}
+#endif
+
+static bool HasInvariantTsc() {
+#if CLOCK_HAS_TSC
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) || eax < 0x80000007)
+    return false;
+  __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+  // CPUID.80000007H:EDX[8] -> TSC runs at a constant rate in all P/C-states.
+  return (edx >> 8) & 1;
+#else
+  return false;
+#endif
+}
+
+void Clock::PublishAnchor(int64_t ticks, int64_t ns, double rate) noexcept {
+  uint64_t seq = anchor_seq.load(std::memory_order_relaxed);
+  anchor_seq.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  base_ticks.store(ticks, std::memory_order_relaxed);
+  base_ns.store(ns, std::memory_order_relaxed);
+  ns_per_tick.store(rate, std::memory_order_relaxed);
+  anchor_seq.store(seq + 2, std::memory_order_release);
+}
+
+void Clock::Calibrate() {
+  if (!HasInvariantTsc()) {
+    use_tsc = false;
+    PublishAnchor(0, 0, 1.0);
+    return;
+  }
+#if CLOCK_HAS_TSC
+  // Spin for ~20ms and compare how far both clocks moved.
+  int64_t start_ns, start_tsc, end_ns, end_tsc;
+  SampleClocks(start_ns, start_tsc);
+  do {
+    SampleClocks(end_ns, end_tsc);
+  } while (end_ns - start_ns < 20000000);
+
+  if (end_tsc <= start_tsc)
+    return;
+  first_ticks = start_tsc;
+  first_ns = start_ns;
+  PublishAnchor(end_tsc, end_ns,
+                static_cast<double>(end_ns - start_ns) /
+                    static_cast<double>(end_tsc - start_tsc));
+  use_tsc = true;
+#endif
+}
+
+void Clock::Reanchor() {
+#if CLOCK_HAS_TSC
+  if (!use_tsc)
+    return;
+  int64_t ns, tsc;
+  SampleClocks(ns, tsc);
+  if (tsc <= first_ticks)
+    return;
+  PublishAnchor(tsc, ns,
+                static_cast<double>(ns - first_ns) /
+                    static_cast<double>(tsc - first_ticks));
+#endif
+}
+
+const char* Clock::Source() noexcept {
+  return use_tsc ? "invariant TSC" : "steady_clock";
+}
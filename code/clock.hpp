@@ -0,0 +1,85 @@
+// Cheap timestamp source for the engine. Timestamps are taken as raw
+// ticks and only converted to microseconds when they are printed.
+
+#ifndef CLOCK_HPP
+#define CLOCK_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CLOCK_HAS_TSC 1
+#else
+#define CLOCK_HAS_TSC 0
+#endif
+
+class Clock {
+  // Chosen once by Calibrate(); steady_clock until then.
+  inline static bool use_tsc = false;
+  // Anchor mapping ticks to CLOCK_MONOTONIC, republished by Reanchor()
+  // under a sequence lock (odd anchor_seq = update in progress).
+  inline static std::atomic<uint64_t> anchor_seq{0};
+  inline static std::atomic<int64_t> base_ticks{0};
+  inline static std::atomic<int64_t> base_ns{0};
+  inline static std::atomic<double> ns_per_tick{1.0};
+  // First calibration sample; Reanchor() measures the rate from here.
+  inline static int64_t first_ticks = 0;
+  inline static int64_t first_ns = 0;
+
+  static void PublishAnchor(int64_t ticks, int64_t ns, double rate) noexcept;
+
+ public:
+  using ticks = int64_t;
+
+  // Reads CPUID for an invariant TSC and, if present, measures its rate
+  // against CLOCK_MONOTONIC. Call once before any other thread starts.
+  static void Calibrate();
+
+  // Takes a fresh (TSC, CLOCK_MONOTONIC) sample and re-derives the rate
+  // over the whole run, so conversion error stays bounded on long runs.
+  // Call periodically from a single background thread; no-op without TSC.
+  static void Reanchor();
+  inline static bool UsesTsc() noexcept { return use_tsc; }
+
+  // Which source Now() reads: "invariant TSC" or "steady_clock".
+  static const char* Source() noexcept;
+  inline static double TicksPerMicrosecond() noexcept {
+    return 1000.0 / ns_per_tick.load(std::memory_order_relaxed);
+  }
+
+  inline static ticks Now() noexcept {
+#if CLOCK_HAS_TSC
+    if (use_tsc)
+      return static_cast<ticks>(__rdtsc());
+#endif
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  // Microseconds on the steady_clock (CLOCK_MONOTONIC) timeline, so both
+  // sources print comparable values.
+  inline static std::chrono::microseconds::rep ToMicroseconds(
+      ticks t) noexcept {
+    if (!use_tsc)
+      return t / 1000;
+    uint64_t seq;
+    int64_t anchor_ticks, anchor_ns;
+    double rate;
+    do {
+      seq = anchor_seq.load(std::memory_order_acquire);
+      anchor_ticks = base_ticks.load(std::memory_order_relaxed);
+      anchor_ns = base_ns.load(std::memory_order_relaxed);
+      rate = ns_per_tick.load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+    } while ((seq & 1) != 0 ||
+             seq != anchor_seq.load(std::memory_order_relaxed));
+    return (anchor_ns + static_cast<int64_t>(
+                            static_cast<double>(t - anchor_ticks) * rate)) /
+           1000;
+  }
+};
+
+#endif
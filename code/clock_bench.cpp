@@ -0,0 +1,43 @@
+// Measures the per-call cost of the timestamp sources used by the engine.
+// Usage: ./clock_bench [iterations]
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+#include "clock.hpp"
+
+template <typename F>
+static void Measure(const char* name, long iterations, F read) {
+  int64_t sink = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (long i = 0; i < iterations; i++)
+    sink += read();
+  auto end = std::chrono::steady_clock::now();
+  double ns = std::chrono::duration<double, std::nano>(end - start).count();
+  // Print the sink so the reads cannot be optimised away.
+  std::cout << name << ": " << ns / static_cast<double>(iterations)
+            << " ns/call (" << (sink & 1) << ")" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+  long iterations = argc > 1 ? std::atol(argv[1]) : 10000000;
+
+  Clock::Calibrate();
+  std::cout << "Clock: " << Clock::Source() << " ("
+            << Clock::TicksPerMicrosecond() << " ticks/us)" << std::endl;
+
+  Measure("steady_clock::now", iterations, [] {
+    return std::chrono::steady_clock::now().time_since_epoch().count();
+  });
+  Measure("Clock::Now", iterations, [] { return Clock::Now(); });
+  Measure("Clock::Now + ToMicroseconds", iterations,
+          [] { return Clock::ToMicroseconds(Clock::Now()); });
+#if CLOCK_HAS_TSC
+  Measure("rdtscp", iterations, [] {
+    unsigned int aux;
+    return static_cast<int64_t>(__rdtscp(&aux));
+  });
+#endif
+  return 0;
+}
@@ -0,0 +1,95 @@
+// Reads binary output records (see io.h) from stdin and prints them in
+// the same text format the engine prints by default.
+
+#define _GNU_SOURCE
+#define _POSIX_C_SOURCE 200809L
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "io.h"
+
+static uint32_t get_u32(const unsigned char *p) {
+  return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 |
+         (uint32_t)p[3] << 24;
+}
+
+static int64_t get_i64(const unsigned char *p) {
+  return (int64_t)((uint64_t)get_u32(p) | (uint64_t)get_u32(p + 4) << 32);
+}
+
+int main(int argc, char *argv[]) {
+  if (argc > 1) {
+    fprintf(stderr, "Usage: %s < <binary output>\n", argv[0]);
+    return 1;
+  }
+
+  // Reading a live pipe from the engine -> print each event as it arrives.
+  struct stat input_stat;
+  if (fstat(fileno(stdin), &input_stat) == 0 && S_ISFIFO(input_stat.st_mode)) {
+    setvbuf(stdout, NULL, _IOLBF, 0);
+  }
+
+  unsigned char record[OUTPUT_RECORD_ADDED_SIZE];
+  int type;
+  while ((type = getchar_unlocked()) != EOF) {
+    size_t size;
+    switch (type) {
+      case record_added_buy:
+      case record_added_sell:
+        size = OUTPUT_RECORD_ADDED_SIZE;
+        break;
+      case record_executed:
+        size = OUTPUT_RECORD_EXECUTED_SIZE;
+        break;
+      case record_deleted:
+        size = OUTPUT_RECORD_DELETED_SIZE;
+        break;
+      default:
+        fprintf(stderr, "Invalid record type 0x%02x\n", type);
+        return 1;
+    }
+
+    // The type byte has already been consumed.
+    if (fread_unlocked(record + 1, 1, size - 1, stdin) != size - 1) {
+      fprintf(stderr, "Truncated record\n");
+      return 1;
+    }
+
+    const unsigned char *p = record + 1;
+    switch (type) {
+      case record_added_buy:
+      case record_added_sell: {
+        char symbol[OUTPUT_SYMBOL_SIZE + 1] = {0};
+        memcpy(symbol, p + 4, OUTPUT_SYMBOL_SIZE);
+        const unsigned char *q = p + 4 + OUTPUT_SYMBOL_SIZE;
+        int64_t input_timestamp = get_i64(q + 8);
+        printf("%c %" PRIu32 " %s %" PRIu32 " %" PRIu32 " %" PRId64
+               " %" PRId64 "\n",
+               type, get_u32(p), symbol, get_u32(q), get_u32(q + 4),
+               input_timestamp, input_timestamp + get_u32(q + 16));
+        break;
+      }
+      case record_executed: {
+        int64_t input_timestamp = get_i64(p + 20);
+        printf("E %" PRIu32 " %" PRIu32 " %" PRIu32 " %" PRIu32
+               " %" PRIu32 " %" PRId64 " %" PRId64 "\n",
+               get_u32(p), get_u32(p + 4), get_u32(p + 8), get_u32(p + 12),
+               get_u32(p + 16), input_timestamp,
+               input_timestamp + get_u32(p + 28));
+        break;
+      }
+      case record_deleted: {
+        int64_t input_timestamp = get_i64(p + 5);
+        printf("X %" PRIu32 " %c %" PRId64 " %" PRId64 "\n", get_u32(p),
+               p[4] ? 'A' : 'R', input_timestamp,
+               input_timestamp + get_u32(p + 13));
+        break;
+      }
+    }
+  }
+
+  return ferror(stdin) || ferror(stdout) ? 1 : 0;
+}
@@ -5,9 +5,106 @@
 #include <mutex>
 #include "io.h"
 #include <map>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+#include <new>
+#include <pthread.h>
 
 std::mutex print_mutex;
 
+// Maximum number of times a combiner drains the pending list before it
+// releases the book, so that no single thread serves others forever.
+static constexpr int kMaxCombinePasses = 4;
+
+// How often the TSC anchor is refreshed against CLOCK_MONOTONIC.
+static constexpr std::chrono::seconds kClockReanchorInterval{1};
+
+// Environment variables selecting the CPUs of each thread role (see Placement::Configure).
+static const struct { const char* role; const char* variable; bool single; } kPlacementSettings[] = {
+  {"accept", "ENGINE_ACCEPT_CPU", true},
+  {"connection", "ENGINE_CONNECTION_CPUS", false},
+  {"output", "ENGINE_OUTPUT_CPU", true},
+  {"clock", "ENGINE_CLOCK_CPU", true},
+};
+
+// Upper bound on how long binary output may sit in the stdio buffer.
+static constexpr std::chrono::milliseconds kBinaryFlushInterval{1};
+
+// SIGINT/SIGTERM call exit() (see main.c) -> keep them off engine threads so
+// the handler never runs on a thread that is holding print_mutex.
+static void BlockExitSignals(){
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, NULL);
+}
+
+// Runs at exit(): flush under print_mutex so no record is cut in half.
+// The lock is deliberately kept so nothing is written after the final flush.
+static void FinalFlush(){
+  print_mutex.lock();
+  Output::Flush();
+}
+
+Engine::Engine() {
+  // Pick the timestamp source before any connection thread reads it.
+  Clock::Calibrate();
+  std::cerr << "Clock: " << Clock::Source() << " (" << Clock::TicksPerMicrosecond() << " ticks/us)" << std::endl;
+  // ENGINE_FLAT_COMBINING=1 -> contended order lists batch requests under one lock holder.
+  const char* flat_combining = std::getenv("ENGINE_FLAT_COMBINING");
+  OrderList::flat_combining = flat_combining != NULL && std::strcmp(flat_combining, "1") == 0;
+  std::cerr << "Order lists: " << (OrderList::flat_combining ? "flat combining (experimental)" : "mutex") << std::endl;
+  // Pin each thread role to its own CPUs, e.g. ENGINE_CONNECTION_CPUS=2-7 ENGINE_OUTPUT_CPU=1.
+  for(auto const& setting : kPlacementSettings){
+    const char* cpu_list = std::getenv(setting.variable);
+    if(cpu_list == NULL)
+      continue;
+    if(Placement::Configure(setting.role, cpu_list, setting.single)){
+      std::cerr << "Pinning " << setting.role << " thread(s) to CPU(s) " << cpu_list << std::endl;
+    }else{
+      std::cerr << "Ignoring invalid " << setting.variable << ": " << cpu_list << std::endl;
+    }
+  }
+  // Engine is created on main.c's accept thread.
+  Placement::PinCurrentThread("accept");
+  orderBook = new OrderBook();
+  std::atexit(FinalFlush);
+  if(Clock::UsesTsc()){
+    std::thread clock_thread{&Engine::ClockThread, this};
+    clock_thread.detach();
+  }
+  if(Output::IsBinary()){
+    std::thread flusher{&Engine::FlushThread, this};
+    flusher.detach();
+  }
+}
+
+// Flush binary output within kBinaryFlushInterval of it being written, see Output::Flush.
+void Engine::FlushThread(){
+  Placement::PinCurrentThread("output");
+  BlockExitSignals();
+  while(true){
+    std::this_thread::sleep_for(kBinaryFlushInterval);
+    // Only contend for print_mutex when something is waiting in the buffer.
+    if(!Output::IsDirty())
+      continue;
+    std::scoped_lock<std::mutex> lock(print_mutex);
+    Output::Flush();
+  }
+}
+
+// Keep TSC timestamps on the CLOCK_MONOTONIC timeline over long runs.
+void Engine::ClockThread(){
+  Placement::PinCurrentThread("clock");
+  BlockExitSignals();
+  while(true){
+    std::this_thread::sleep_for(kClockReanchorInterval);
+    Clock::Reanchor();
+  }
+}
+
 void Engine::Accept(ClientConnection connection) {
   // std::cout << "New Thread" << std::endl;
   std::thread thread{&Engine::ConnectionThread, this,
@@ -16,18 +113,27 @@ void Engine::Accept(ClientConnection connection) {
 }
 
 void Engine::ConnectionThread(ClientConnection connection) {
+  // Books this thread creates are owned by its pinned CPU's node.
+  Placement::PinCurrentThread("connection");
+  BlockExitSignals();
   while (true) {
     input input;
     switch (connection.ReadInput(input)) {
       case ReadResult::Error:
         std::cerr << "Error reading input" << std::endl;
+        [[fallthrough]];
       case ReadResult::EndOfFile:
+        {
+          std::scoped_lock<std::mutex> lock(print_mutex);
+          Output::Flush();
+        }
+        Placement::ForgetCurrentThread();
         return;
       case ReadResult::Success:
         break;
     }
 
-    int64_t input_time = CurrentTimestamp();
+    Clock::ticks input_time = Clock::Now();
     
     // Functions for printing output actions in the prescribed format are
     // provided in the Output class:
@@ -39,7 +145,7 @@ void Engine::ConnectionThread(ClientConnection connection) {
           
           if(instrument_name.empty()){
             std::scoped_lock<std::mutex> lock(print_mutex);
-            Output::OrderDeleted(input.order_id, false, input_time, CurrentTimestamp());
+            Output::OrderDeleted(input.order_id, false, Clock::ToMicroseconds(input_time), CurrentTimestamp());
             break;
           }
           // Else, Retrieve order list by instrument name.
@@ -52,14 +158,14 @@ void Engine::ConnectionThread(ClientConnection connection) {
       {
         // Retrieve order list by instrument name.
         OrderList* orderList = orderBook->getOrderList(input.order_id, input.instrument, false);
-        Order* newOrder = new Order( input.order_id, input.count, input.price,  input.type == input_sell ? sell : buy);
-        // Execute Order matching against new Order.
-        orderList->matchOrder(newOrder, input_time);
+        // Execute Order matching against new Order (allocated by the Order List).
+        orderList->matchOrder(input.order_id, input.count, input.price, input.type == input_sell ? sell : buy, input_time);
         break;
       }
       default:
         // Print Order Book -> modified io.h to allow input 'P'
         orderBook->printOrderBook();
+        orderBook->printPlacement();
         break;
     }
   }
@@ -67,7 +173,7 @@ void Engine::ConnectionThread(ClientConnection connection) {
 
 // For Debugging, to see all instrument and its respective resting orders.
 void OrderBook::printOrderBook(){
-  std::scoped_lock<std::mutex> lock(this->orderbook_mutex);
+  std::shared_lock<std::shared_mutex> lock(this->instrument_map_mutex);
   std::cout << "============================================" << std::endl;
   std::cout << "[Order Book]" << std::endl;
   for(auto const& [instrument_name, order_list] : this->instrument_map){
@@ -76,6 +182,24 @@ void OrderBook::printOrderBook(){
   std::cout << "============================================" << std::endl;
 }
 
+// For Debugging, to see which CPU/node each thread and book lives on (written to stderr).
+void OrderBook::printPlacement(){
+  std::shared_lock<std::shared_mutex> lock(this->instrument_map_mutex);
+  std::cerr << "============================================" << std::endl;
+  std::cerr << "[Placement]" << std::endl;
+  Placement::Dump(std::cerr);
+  std::cerr << "[Books]" << std::endl;
+  for(auto const& [instrument_name, order_list] : this->instrument_map){
+    std::cerr << instrument_name << " home node ";
+    if(order_list->home_node == -1)
+      std::cerr << "none (unpinned)";
+    else
+      std::cerr << order_list->home_node;
+    std::cerr << ", memory on node " << Placement::NodeOf(order_list) << std::endl;
+  }
+  std::cerr << "============================================" << std::endl;
+}
+
 // For Debugging, to see all instrument and its respective resting orders.
 void OrderList::printOrders(){
   std::scoped_lock<std::mutex> lock(this->instrument_mutex);
@@ -91,25 +215,102 @@ void OrderList::printOrders(){
 
 // Retrieve Instrument Name via Order ID
 std::string OrderBook::getInstructmentByID(int order_id){
-  // Lock Order Book.
-  std::scoped_lock lock(this->orderbook_mutex);
+  // Lock the stripe holding this Order ID.
+  OrderStripe& stripe = stripeFor(order_id);
+  std::scoped_lock<std::mutex> lock(stripe.mutex);
   // Iterative Map to find order id
-  std::map<int, std::string>::iterator iter = this->order_to_instrument.find(order_id);
+  std::map<int, std::string>::iterator iter = stripe.order_to_instrument.find(order_id);
   // The only time this function is executed, is when we are cancelling order.
   // Hence, we already can erase from the map before executing Cancel Order.
-  if (iter != this->order_to_instrument.end()){
+  if (iter != stripe.order_to_instrument.end()){
     std::string instrument_name = iter->second;
-    this->order_to_instrument.erase(iter);
+    stripe.order_to_instrument.erase(iter);
     return instrument_name;
   }
   return "";
 }
 
+// Publish a request and wait until some lock holder (possibly this thread) has executed it.
+void OrderList::submitRequest(OrderRequest& request){
+  request.next = this->pending_requests.load(std::memory_order_relaxed);
+  while(!this->pending_requests.compare_exchange_weak(request.next, &request, std::memory_order_release, std::memory_order_relaxed));
+
+  while(!request.done.load(std::memory_order_acquire)){
+    if(this->instrument_mutex.try_lock()){
+      // Become the combiner -> serve our own request and everyone else's while the book is hot.
+      combineRequests();
+      this->instrument_mutex.unlock();
+    }else{
+      std::this_thread::yield();
+    }
+  }
+}
+
+// Execute pending requests. Caller must hold instrument_mutex.
+void OrderList::combineRequests(){
+  for(int pass = 0; pass < kMaxCombinePasses; pass++){
+    OrderRequest* batch = this->pending_requests.exchange(NULL, std::memory_order_acquire);
+    if(batch == NULL)
+      return;
+    // The list is pushed LIFO -> reverse it so requests run in arrival order.
+    OrderRequest* ordered = NULL;
+    while(batch != NULL){
+      OrderRequest* next = batch->next;
+      batch->next = ordered;
+      ordered = batch;
+      batch = next;
+    }
+    while(ordered != NULL){
+      // Read next first: the owner may return and free the request once done is set.
+      OrderRequest* next = ordered->next;
+      if(ordered->kind == OrderRequest::match)
+        executeMatch(newOrder(ordered->order_ID, ordered->size, ordered->price, ordered->side), ordered->input_time_stamp);
+      else
+        executeCancel(ordered->order_ID, ordered->input_time_stamp);
+      ordered->done.store(true, std::memory_order_release);
+      ordered = next;
+    }
+  }
+}
+
 // Cancel Order.
-void OrderList::cancelOrder(int order_id, std::chrono::microseconds::rep input_time_stamp){
-  // Find Order object through resting_orders from the Order List.
+void OrderList::cancelOrder(int order_id, Clock::ticks input_time_stamp){
+  if(flat_combining){
+    OrderRequest request{OrderRequest::cancel, order_id, 0, 0, buy, input_time_stamp};
+    submitRequest(request);
+    return;
+  }
+  std::scoped_lock<std::mutex> lock(this->instrument_mutex);
+  executeCancel(order_id, input_time_stamp);
+}
+
+// Perform matching, see executeMatch.
+void OrderList::matchOrder(int order_id, int size, int price, OrderType side, Clock::ticks input_time_stamp){
+  if(flat_combining){
+    OrderRequest request{OrderRequest::match, order_id, size, price, side, input_time_stamp};
+    submitRequest(request);
+    return;
+  }
   std::scoped_lock<std::mutex> lock(this->instrument_mutex);
-  std::map<int, Order*>::iterator iter = resting_orders.find(order_id) ;
+  executeMatch(newOrder(order_id, size, price, side), input_time_stamp);
+}
+
+// Allocate an Order from this book's pool. Caller must hold instrument_mutex.
+Order* OrderList::newOrder(int order_id, int size, int price, OrderType side){
+  void* memory = this->order_pool.allocate(sizeof(Order), alignof(Order));
+  return new (memory) Order(order_id, size, price, side);
+}
+
+// Return an Order to this book's pool. Caller must hold instrument_mutex.
+void OrderList::deleteOrder(Order* order){
+  order->~Order();
+  this->order_pool.deallocate(order, sizeof(Order), alignof(Order));
+}
+
+// Cancel Order. Caller must hold instrument_mutex.
+void OrderList::executeCancel(int order_id, Clock::ticks input_time_stamp){
+  // Find Order object through resting_orders from the Order List.
+  std::pmr::map<int, Order*>::iterator iter = resting_orders.find(order_id) ;
   
   if (iter != resting_orders.end()){
     // Order exist -> perform pointer readjustments  
@@ -129,30 +330,27 @@ void OrderList::cancelOrder(int order_id, std::chrono::microseconds::rep input_t
       del_order->prev->next = NULL;
     }else{
       del_order->prev->next = del_order->next;
-      del_order->next = del_order->prev;
+      del_order->next->prev = del_order->prev;
     }
     // Erase from map and free memory.
     resting_orders.erase(iter);
-    delete del_order;
+    deleteOrder(del_order);
     del_order = NULL;
     {
       std::scoped_lock<std::mutex> lock(print_mutex);
-      Output::OrderDeleted(order_id, true, input_time_stamp, CurrentTimestamp());
+      Output::OrderDeleted(order_id, true, Clock::ToMicroseconds(input_time_stamp), CurrentTimestamp());
     }
   }else{
       // Order doesn't exist -> either false or fufilled order.
     {
       std::scoped_lock<std::mutex> lock(print_mutex);
-      Output::OrderDeleted(order_id, false, input_time_stamp, CurrentTimestamp());
+      Output::OrderDeleted(order_id, false, Clock::ToMicroseconds(input_time_stamp), CurrentTimestamp());
     }
   }
 }
 
-// Perform matching through Doubly Linked List.
-void OrderList::matchOrder(Order* new_order, std::chrono::microseconds::rep input_time_stamp){
-  // Lock the order list.
-  std::scoped_lock<std::mutex> lock(this->instrument_mutex);
-
+// Perform matching through Doubly Linked List. Caller must hold instrument_mutex.
+void OrderList::executeMatch(Order* new_order, Clock::ticks input_time_stamp){
   if(new_order->side == buy){
     // There's no sell resting order, hence just insert Buy Order.
     if(this->s_head == NULL){
@@ -169,23 +367,23 @@ void OrderList::matchOrder(Order* new_order, std::chrono::microseconds::rep inpu
         cur_order->setSize(cur_order->size - new_order->size);
         {
           std::scoped_lock<std::mutex> lock(print_mutex);
-          Output::OrderExecuted(cur_order->ID, new_order->ID, cur_order->executedAmount, cur_order->price, new_order->size, input_time_stamp, CurrentTimestamp());
+          Output::OrderExecuted(cur_order->ID, new_order->ID, cur_order->executedAmount, cur_order->price, new_order->size, Clock::ToMicroseconds(input_time_stamp), CurrentTimestamp());
         }
+        // Fully filled -> the loop stops here; freed once matching is done.
         new_order->setSize(0);
-        delete new_order;
       }else{
         new_order->setSize(new_order->size - cur_order->size);
         {
           std::scoped_lock<std::mutex> lock(print_mutex);
-          Output::OrderExecuted(cur_order->ID, new_order->ID, cur_order->executedAmount, cur_order->price, cur_order->size, input_time_stamp, CurrentTimestamp());
+          Output::OrderExecuted(cur_order->ID, new_order->ID, cur_order->executedAmount, cur_order->price, cur_order->size, Clock::ToMicroseconds(input_time_stamp), CurrentTimestamp());
         }
         tmp = cur_order;
         cur_order = cur_order->next;
-        std::map<int, Order*>::iterator iter = this->resting_orders.find(tmp->ID);
+        std::pmr::map<int, Order*>::iterator iter = this->resting_orders.find(tmp->ID);
         if (iter != resting_orders.end())
           resting_orders.erase(iter);
         if(tmp != NULL){
-          delete tmp;
+          deleteOrder(tmp);
           tmp = NULL;
         }
       }
@@ -211,25 +409,25 @@ void OrderList::matchOrder(Order* new_order, std::chrono::microseconds::rep inpu
         cur_order->setSize(cur_order->size - new_order->size);
         {
           std::scoped_lock<std::mutex> lock(print_mutex);
-          Output::OrderExecuted(cur_order->ID, new_order->ID, cur_order->executedAmount, cur_order->price, new_order->size, input_time_stamp, CurrentTimestamp());
+          Output::OrderExecuted(cur_order->ID, new_order->ID, cur_order->executedAmount, cur_order->price, new_order->size, Clock::ToMicroseconds(input_time_stamp), CurrentTimestamp());
         }
+        // Fully filled -> the loop stops here; freed once matching is done.
         new_order->setSize(0);
-        delete new_order;
       }else{
         // Update incoming order size.
         new_order->setSize(new_order->size - cur_order->size);
         {
           std::scoped_lock<std::mutex> lock(print_mutex);
-          Output::OrderExecuted(cur_order->ID, new_order->ID, cur_order->executedAmount, cur_order->price, cur_order->size, input_time_stamp, CurrentTimestamp());
+          Output::OrderExecuted(cur_order->ID, new_order->ID, cur_order->executedAmount, cur_order->price, cur_order->size, Clock::ToMicroseconds(input_time_stamp), CurrentTimestamp());
         }
         tmp = cur_order;
         cur_order = cur_order->next;
         // Delete the resting order from memory and map as it has been fufilled.
-        std::map<int, Order*>::iterator iter = this->resting_orders.find(tmp->ID);
+        std::pmr::map<int, Order*>::iterator iter = this->resting_orders.find(tmp->ID);
         if (iter != resting_orders.end())
           resting_orders.erase(iter);
         if(tmp != NULL){
-          delete tmp;
+          deleteOrder(tmp);
           tmp = NULL;
         }
       }
@@ -245,10 +443,12 @@ void OrderList::matchOrder(Order* new_order, std::chrono::microseconds::rep inpu
       insertBuyOrder(new_order, input_time_stamp);
     else
       insertSellOrder(new_order, input_time_stamp);
+  }else{
+    deleteOrder(new_order);
   }
 }
 
-void OrderList::insertBuyOrder(Order* new_order, std::chrono::microseconds::rep input_time_stamp){
+void OrderList::insertBuyOrder(Order* new_order, Clock::ticks input_time_stamp){
   // Insert into resting order map.
   this->resting_orders.insert(std::pair<int, Order*>(new_order->ID, new_order));
 
@@ -278,12 +478,12 @@ void OrderList::insertBuyOrder(Order* new_order, std::chrono::microseconds::rep
   }
   {
     std::scoped_lock<std::mutex> lock(print_mutex);
-    Output::OrderAdded(new_order->ID, this->instrument.c_str(), new_order->price, new_order->size, false, input_time_stamp, CurrentTimestamp());
+    Output::OrderAdded(new_order->ID, this->instrument.c_str(), new_order->price, new_order->size, false, Clock::ToMicroseconds(input_time_stamp), CurrentTimestamp());
   }
 }
 
 
-void OrderList::insertSellOrder(Order* new_order, std::chrono::microseconds::rep input_time_stamp){
+void OrderList::insertSellOrder(Order* new_order, Clock::ticks input_time_stamp){
   // Insert into resting order map.
   this->resting_orders.insert(std::pair<int, Order*>(new_order->ID, new_order));
 
@@ -312,26 +512,38 @@ void OrderList::insertSellOrder(Order* new_order, std::chrono::microseconds::rep
   }
   {
     std::scoped_lock<std::mutex> lock(print_mutex);
-    Output::OrderAdded(new_order->ID, this->instrument.c_str(), new_order->price, new_order->size, true, input_time_stamp, CurrentTimestamp());
+    Output::OrderAdded(new_order->ID, this->instrument.c_str(), new_order->price, new_order->size, true, Clock::ToMicroseconds(input_time_stamp), CurrentTimestamp());
   }
 }
 
 // Retrieve OrderList for a specific instrument.
 OrderList* OrderBook::getOrderList(int order_id, std::string instrument_name, bool is_cancel){
-  // Lock the Order Book.
-  std::scoped_lock<std::mutex> lock(this->orderbook_mutex);
-  auto it = this->instrument_map.find(instrument_name);
-
-  if(!is_cancel)
+  if(!is_cancel){
     // Operation is used for Matching Order, hence record down the Order ID <-> Instrument Name pair.
     // Will be used for cancelling orders.
-    this->order_to_instrument.insert(std::pair<int, std::string>(order_id, instrument_name));
-  
+    OrderStripe& stripe = stripeFor(order_id);
+    std::scoped_lock<std::mutex> lock(stripe.mutex);
+    stripe.order_to_instrument.insert(std::pair<int, std::string>(order_id, instrument_name));
+  }
+  {
+    // Fast path: the book already exists -> shared lock only.
+    std::shared_lock<std::shared_mutex> lock(this->instrument_map_mutex);
+    auto it = this->instrument_map.find(instrument_name);
+    if (it != this->instrument_map.end())
+      return it->second;
+  }
+
+  std::unique_lock<std::shared_mutex> lock(this->instrument_map_mutex);
+  // Another thread may have created it between the two locks.
+  auto it = this->instrument_map.find(instrument_name);
   if (it == this->instrument_map.end()){
     // There's no order list for this instrument yet -> Create one.
-    OrderList* newOrderList = new OrderList(instrument_name);
+    // Owned by this thread's pinned node, and allocated from that node's memory.
+    int node = Placement::PinnedNode();
+    void* memory = Placement::NodeMemory(node)->allocate(sizeof(OrderList), alignof(OrderList));
+    OrderList* newOrderList = new (memory) OrderList(instrument_name, node);
     this->instrument_map.insert(std::pair<std::string, OrderList*>(instrument_name, newOrderList));
     return newOrderList;
   }
   return it->second;
-}
\ No newline at end of file
+}
@@ -5,11 +5,16 @@
 #define ENGINE_HPP
 
 #include <chrono>
+#include "clock.hpp"
+#include "placement.hpp"
 #include "io.h"
 #include <map>
+#include <memory_resource>
 #include <string>
 #include <vector>
 #include <mutex>
+#include <shared_mutex>
+#include <atomic>
 
 enum OrderType {buy, sell};
 
@@ -27,29 +32,70 @@ class Order{
     Order(int _id, int _size, int _price, OrderType _type): ID(_id), size(_size), price(_price), side(_type), executedAmount(0){}
 };
 
+// A match or cancel published by a connection thread for flat combining.
+// Lives on the publishing thread's stack until 'done' is set.
+struct OrderRequest{
+  enum Kind {match, cancel};
+  Kind kind;
+  int order_ID;
+  int size;
+  int price;
+  OrderType side;
+  Clock::ticks input_time_stamp;
+  OrderRequest* next = NULL;
+  std::atomic<bool> done{false};
+};
+
 class OrderList{
   private:
     Order* b_head = NULL; // Sorted Descending (Buy)
     Order* s_head = NULL; // Sorted Ascending (Sell)
     std::string instrument;
     std::mutex instrument_mutex;
-    std::map<int, Order*> resting_orders;
+    // Orders and map nodes of this book, carved from home_node's memory.
+    // Only used under instrument_mutex.
+    std::pmr::unsynchronized_pool_resource order_pool;
+    std::pmr::map<int, Order*> resting_orders;
+    // Requests waiting for a combiner (flat combining mode only).
+    std::atomic<OrderRequest*> pending_requests{NULL};
+    void submitRequest(OrderRequest& request);
+    void combineRequests();
+    Order* newOrder(int order_ID, int size, int price, OrderType side);
+    void deleteOrder(Order* order);
+    void executeMatch(Order* order, Clock::ticks input_time_stamp);
+    void executeCancel(int order_ID, Clock::ticks input_time_stamp);
   public:
+    // When set, contending threads hand requests to the instrument_mutex holder to run in a batch.
+    inline static bool flat_combining = false;
+    // NUMA node owning this book's memory: the node of the pinned CPU of the
+    // thread that created it, or -1 when threads are not pinned.
+    const int home_node;
     void printOrders();
-    void matchOrder(Order* order, std::chrono::microseconds::rep input_time_stamp);
-    void cancelOrder(int order_ID, std::chrono::microseconds::rep input_time_stamp);
-    void insertSellOrder(Order* order, std::chrono::microseconds::rep input_time_stamp);
-    void insertBuyOrder(Order* order, std::chrono::microseconds::rep input_time_stamp);
-    OrderList(std::string instrument_name): instrument(instrument_name){};
+    void matchOrder(int order_ID, int size, int price, OrderType side, Clock::ticks input_time_stamp);
+    void cancelOrder(int order_ID, Clock::ticks input_time_stamp);
+    void insertSellOrder(Order* order, Clock::ticks input_time_stamp);
+    void insertBuyOrder(Order* order, Clock::ticks input_time_stamp);
+    OrderList(std::string instrument_name, int node): instrument(instrument_name), order_pool(Placement::NodeMemory(node)), resting_orders(&order_pool), home_node(node){};
+};
+
+// Order ID -> instrument name for one slice of the order ID space.
+struct alignas(64) OrderStripe{
+  std::mutex mutex;
+  std::map<int, std::string> order_to_instrument;
 };
 
 class OrderBook{
   private:
-    std::mutex orderbook_mutex;
-    std::map<int, std::string> order_to_instrument;
+    static constexpr unsigned kOrderStripes = 64;
+    // Readers look up existing books concurrently; only creating a book takes it exclusively.
+    std::shared_mutex instrument_map_mutex;
     std::map<std::string, OrderList*> instrument_map;
+    // Striped by order ID so recording/looking up orders doesn't serialize on one lock.
+    OrderStripe order_stripes[kOrderStripes];
+    OrderStripe& stripeFor(int order_id){ return order_stripes[static_cast<unsigned>(order_id) % kOrderStripes]; }
   public:
     void printOrderBook();
+    void printPlacement();
     std::string getInstructmentByID(int order_ID);
     OrderList* getOrderList(int order_id, std::string instrument_name, bool is_cancel);
 };
@@ -57,17 +103,17 @@ class OrderBook{
 class Engine {
 
   void ConnectionThread(ClientConnection);
+  void FlushThread();
+  void ClockThread();
 
  public:
     OrderBook* orderBook;
-    Engine(){ orderBook = new OrderBook();}
+    Engine();
     void Accept(ClientConnection);
 };
 
 inline static std::chrono::microseconds::rep CurrentTimestamp() noexcept {
-  return std::chrono::duration_cast<std::chrono::microseconds>(
-             std::chrono::steady_clock::now().time_since_epoch())
-      .count();
+  return Clock::ToMicroseconds(Clock::Now());
 }
 
 #endif
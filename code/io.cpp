@@ -12,6 +12,10 @@ void engine_accept(void *engine, void *file) {
   static_cast<Engine *>(engine)->Accept(ClientConnection{file});
 }
 
+void output_set_binary(void *file) {
+  Output::SetBinaryFile(static_cast<FILE *>(file));
+}
+
 int read_input(void *file, struct input *output);
 
 struct _IO_FILE;
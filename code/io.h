@@ -7,7 +7,9 @@
 
 #ifdef __cplusplus
 
+#include <atomic>
 #include <cstdint>
+#include <cstdio>
 #include <iostream>
 extern "C" {
 #else
@@ -25,6 +27,31 @@ struct input {
   char instrument[9];
 };
 
+// Binary output mode: every event is written as one fixed-size record of
+// little-endian fields, led by a single type byte. decoder.c turns a
+// stream of these back into the text format printed by Output.
+//
+//   added:    type('B'/'S') id:u32 symbol:char[8] price:u32 count:u32
+//             input_timestamp:i64 latency:u32
+//   executed: type('E') resting_id:u32 new_id:u32 execution_id:u32
+//             price:u32 count:u32 input_timestamp:i64 latency:u32
+//   deleted:  type('X') id:u32 accepted:u8 input_timestamp:i64 latency:u32
+//
+// latency is output_timestamp - input_timestamp in microseconds, which
+// is tiny next to the absolute timestamp, so only the input side pays for
+// 64 bits. Latencies above UINT32_MAX (~71 minutes) are saturated.
+enum output_record_type {
+  record_added_buy = 'B',
+  record_added_sell = 'S',
+  record_executed = 'E',
+  record_deleted = 'X'
+};
+
+#define OUTPUT_SYMBOL_SIZE 8
+#define OUTPUT_RECORD_ADDED_SIZE 33
+#define OUTPUT_RECORD_EXECUTED_SIZE 33
+#define OUTPUT_RECORD_DELETED_SIZE 18
+
 #ifdef __cplusplus
 }
 
@@ -58,13 +85,77 @@ class ClientConnection {
 };
 
 class Output {
- 
+  // Set once at startup by output_set_binary(); nullptr keeps text output.
+  inline static FILE* binary_file = nullptr;
+  // Records written since the last Flush(). Set under the caller's print
+  // lock, read without it by the engine's flush thread.
+  inline static std::atomic<bool> dirty{false};
+
+  inline static unsigned char* PutU32(unsigned char* p, uint32_t value) {
+    for (int i = 0; i < 4; i++)
+      *p++ = static_cast<unsigned char>(value >> (8 * i));
+    return p;
+  }
+
+  inline static unsigned char* PutI64(unsigned char* p, intmax_t value) {
+    uint64_t bits = static_cast<uint64_t>(value);
+    for (int i = 0; i < 8; i++)
+      *p++ = static_cast<unsigned char>(bits >> (8 * i));
+    return p;
+  }
+
+  inline static unsigned char* PutLatency(unsigned char* p,
+                                         intmax_t input_timestamp,
+                                         intmax_t output_timestamp) {
+    intmax_t latency = output_timestamp - input_timestamp;
+    if (latency < 0) latency = 0;
+    if (latency > UINT32_MAX) latency = UINT32_MAX;
+    return PutU32(p, static_cast<uint32_t>(latency));
+  }
+
+  inline static void WriteRecord(const unsigned char* record, size_t size) {
+    fwrite_unlocked(record, 1, size, binary_file);
+    dirty.store(true, std::memory_order_relaxed);
+  }
+
  public:
+  inline static void SetBinaryFile(FILE* file) { binary_file = file; }
+  inline static bool IsBinary() { return binary_file != nullptr; }
+  inline static bool IsDirty() {
+    return dirty.load(std::memory_order_relaxed);
+  }
+
+  // Text output flushes per line; binary output is fully buffered, so the
+  // engine flushes it periodically and whenever a client leaves.
+  inline static void Flush() {
+    if (binary_file) {
+      dirty.store(false, std::memory_order_relaxed);
+      fflush_unlocked(binary_file);
+    } else {
+      std::cout.flush();
+    }
+  }
+
   inline static void OrderAdded(uint32_t id, const char* symbol,
                                 uint32_t price, uint32_t count,
                                 bool is_sell_side,
                                 intmax_t input_timestamp,
                                 intmax_t output_timestamp) {
+    if (binary_file) {
+      unsigned char record[OUTPUT_RECORD_ADDED_SIZE] = {0};
+      unsigned char* p = record;
+      *p++ = is_sell_side ? record_added_sell : record_added_buy;
+      p = PutU32(p, id);
+      for (int i = 0; i < OUTPUT_SYMBOL_SIZE && symbol[i] != '\0'; i++)
+        p[i] = symbol[i];
+      p += OUTPUT_SYMBOL_SIZE;
+      p = PutU32(p, price);
+      p = PutU32(p, count);
+      p = PutI64(p, input_timestamp);
+      PutLatency(p, input_timestamp, output_timestamp);
+      WriteRecord(record, sizeof(record));
+      return;
+    }
     std::cout << (is_sell_side ? "S" : "B") << " " << id << " " << symbol
               << " " << price << " " << count << " " << input_timestamp
               << " " << output_timestamp << std::endl;
@@ -75,6 +166,20 @@ class Output {
                                    uint32_t count,
                                    intmax_t input_timestamp,
                                    intmax_t output_timestamp) {
+    if (binary_file) {
+      unsigned char record[OUTPUT_RECORD_EXECUTED_SIZE];
+      unsigned char* p = record;
+      *p++ = record_executed;
+      p = PutU32(p, resting_id);
+      p = PutU32(p, new_id);
+      p = PutU32(p, execution_id);
+      p = PutU32(p, price);
+      p = PutU32(p, count);
+      p = PutI64(p, input_timestamp);
+      PutLatency(p, input_timestamp, output_timestamp);
+      WriteRecord(record, sizeof(record));
+      return;
+    }
     std::cout << "E " << resting_id << " " << new_id << " "
               << execution_id << " " << price << " " << count << " "
               << input_timestamp << " " << output_timestamp << std::endl;
@@ -83,6 +188,17 @@ class Output {
   inline static void OrderDeleted(uint32_t id, bool cancel_accepted,
                                   intmax_t input_timestamp,
                                   intmax_t output_timestamp) {
+    if (binary_file) {
+      unsigned char record[OUTPUT_RECORD_DELETED_SIZE];
+      unsigned char* p = record;
+      *p++ = record_deleted;
+      p = PutU32(p, id);
+      *p++ = cancel_accepted ? 1 : 0;
+      p = PutI64(p, input_timestamp);
+      PutLatency(p, input_timestamp, output_timestamp);
+      WriteRecord(record, sizeof(record));
+      return;
+    }
     std::cout << "X " << id << " " << (cancel_accepted ? "A" : "R") << " "
               << input_timestamp << " " << output_timestamp << std::endl;
   }
@@ -16,6 +16,7 @@
 
 void *engine_new(void);
 void engine_accept(void *engine, void *file);
+void output_set_binary(void *file);
 
 int read_input(void *file, struct input *output) {
   if (fread_unlocked(output, 1, sizeof(*output), file) !=
@@ -47,10 +48,23 @@ static void exit_cleanup(void) {
 
 int main(int argc, char *argv[]) {
   if (argc < 2) {
-    fprintf(stderr, "Usage: %s <socket path>\n", argv[0]);
+    fprintf(stderr, "Usage: %s <socket path> [binary output path]\n",
+            argv[0]);
     return 1;
   }
 
+  // Optional binary output: fixed-size records written to a file or pipe
+  // instead of text on stdout. Use ./decoder to read them back as text.
+  if (argc >= 3) {
+    FILE *binary_output = fopen(argv[2], "wb");
+    if (!binary_output) {
+      perror("fopen");
+      return 1;
+    }
+    setvbuf(binary_output, NULL, _IOFBF, 1 << 16);
+    output_set_binary(binary_output);
+  }
+
   socketpath = argv[1];
   listenfd = socket(AF_UNIX, SOCK_STREAM, 0);
   if (listenfd == -1) {
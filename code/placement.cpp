@@ -0,0 +1,155 @@
+#include "placement.hpp"
+
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+void* NodeMemoryResource::do_allocate(size_t bytes, size_t alignment) {
+  std::scoped_lock<std::mutex> lock(chunk_mutex);
+  uintptr_t start = (reinterpret_cast<uintptr_t>(next) + alignment - 1) & ~(alignment - 1);
+  if (next == nullptr || start + bytes > reinterpret_cast<uintptr_t>(end)) {
+    size_t size = bytes + alignment > kChunkSize ? bytes + alignment : kChunkSize;
+    void* chunk = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (chunk == MAP_FAILED)
+      throw std::bad_alloc();
+    // Set the policy before anything touches the chunk, so every page faults in on 'node'
+    // while it has free memory.
+    constexpr size_t kMaskBits = 1024;
+    unsigned long mask[kMaskBits / (8 * sizeof(unsigned long))] = {0};
+    if (node >= 0 && static_cast<size_t>(node) < kMaskBits) {
+      mask[node / (8 * sizeof(unsigned long))] |= 1UL << (node % (8 * sizeof(unsigned long)));
+      if (syscall(SYS_mbind, chunk, size, MPOL_PREFERRED, mask, kMaskBits + 1, 0) != 0)
+        preferred.store(false, std::memory_order_relaxed);
+    } else {
+      preferred.store(false, std::memory_order_relaxed);
+    }
+    next = static_cast<char*>(chunk);
+    end = next + size;
+    start = (reinterpret_cast<uintptr_t>(next) + alignment - 1) & ~(alignment - 1);
+  }
+  next = reinterpret_cast<char*>(start + bytes);
+  return reinterpret_cast<void*>(start);
+}
+
+// Reads a CPU number made only of digits (no sign or whitespace).
+static bool ParseCpu(const char*& p, long& cpu) {
+  if (*p < '0' || *p > '9')
+    return false;
+  cpu = 0;
+  while (*p >= '0' && *p <= '9') {
+    cpu = cpu * 10 + (*p++ - '0');
+    if (cpu >= CPU_SETSIZE)
+      return false;
+  }
+  return true;
+}
+
+bool Placement::Configure(const std::string& role, const char* cpu_list, bool single) {
+  cpu_set_t allowed;
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+    return false;
+
+  cpu_set_t seen;
+  CPU_ZERO(&seen);
+  std::vector<int> parsed;
+  const char* p = cpu_list;
+  while (true) {
+    long first, last;
+    if (!ParseCpu(p, first))
+      return false;
+    last = first;
+    if (*p == '-') {
+      p++;
+      if (!ParseCpu(p, last) || last < first)
+        return false;
+    }
+    for (long cpu = first; cpu <= last; cpu++) {
+      if (!CPU_ISSET(cpu, &allowed) || CPU_ISSET(cpu, &seen))
+        return false;
+      CPU_SET(cpu, &seen);
+      parsed.push_back(static_cast<int>(cpu));
+    }
+    if (*p == '\0')
+      break;
+    // Another entry must follow a comma, so "0," is rejected.
+    if (*p++ != ',')
+      return false;
+  }
+  if (single && parsed.size() != 1)
+    return false;
+  role_cpus[role].cpus = parsed;
+  return true;
+}
+
+void Placement::PinCurrentThread(const char* role) {
+  int cpu = -1;
+  auto configured = role_cpus.find(role);
+  if (configured != role_cpus.end()) {
+    RoleCpus& cpus = configured->second;
+    cpu = cpus.cpus[cpus.next.fetch_add(1, std::memory_order_relaxed) % cpus.cpus.size()];
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0)
+      cpu = -1;
+  }
+  // sched_setaffinity has already migrated us, so this is the pinned node.
+  int node = CurrentNode();
+  pinned_node = cpu == -1 ? -1 : node;
+  std::scoped_lock<std::mutex> lock(threads_mutex);
+  threads[gettid()] = ThreadRecord{role, cpu, node};
+}
+
+void Placement::ForgetCurrentThread() {
+  std::scoped_lock<std::mutex> lock(threads_mutex);
+  threads.erase(gettid());
+}
+
+std::pmr::memory_resource* Placement::NodeMemory(int node) {
+  if (node < 0)
+    return std::pmr::new_delete_resource();
+  std::scoped_lock<std::mutex> lock(node_memory_mutex);
+  NodeMemoryResource*& memory = node_memory[node];
+  if (memory == nullptr)
+    memory = new NodeMemoryResource(node);
+  return memory;
+}
+
+int Placement::CurrentNode() {
+  unsigned int cpu, node;
+  if (getcpu(&cpu, &node) != 0)
+    return -1;
+  return static_cast<int>(node);
+}
+
+int Placement::NodeOf(const void* address) {
+  // move_pages with no target nodes only reports where each page lives.
+  void* page = const_cast<void*>(address);
+  int status = -1;
+  if (syscall(SYS_move_pages, 0, 1UL, &page, nullptr, &status, 0) != 0)
+    return -1;
+  return status < 0 ? -1 : status;
+}
+
+void Placement::Dump(std::ostream& out) {
+  out << "[Threads]" << std::endl;
+  std::scoped_lock<std::mutex> lock(threads_mutex);
+  for (auto const& [tid, record] : threads) {
+    out << record.role << " " << tid << " cpu ";
+    if (record.cpu == -1)
+      out << "any";
+    else
+      out << record.cpu;
+    out << " node " << record.node << std::endl;
+  }
+  out << "[Node memory]" << std::endl;
+  std::scoped_lock<std::mutex> memory_lock(node_memory_mutex);
+  for (auto const& [node, memory] : node_memory)
+    out << "node " << node << " memory " << (memory->IsPreferred() ? "preferred (mbind)" : "no policy (first touch)") << std::endl;
+}
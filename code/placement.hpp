@@ -0,0 +1,88 @@
+// CPU pinning of engine threads, memory placed on NUMA nodes, and a
+// diagnostic dump of where threads and instrument books ended up.
+
+#ifndef PLACEMENT_HPP
+#define PLACEMENT_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <map>
+#include <memory_resource>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Hands out memory from mmap'd chunks that prefer one NUMA node (mbind
+// MPOL_PREFERRED), so pages land on that node no matter which thread
+// touches them first, but spill to other nodes instead of OOMing when it
+// is full. Memory is never returned to the OS; pool resources layered on
+// top recycle it.
+class NodeMemoryResource : public std::pmr::memory_resource {
+  static constexpr size_t kChunkSize = 2 << 20;
+
+  const int node;
+  std::mutex chunk_mutex;
+  char* next = nullptr;
+  char* end = nullptr;
+  // False once mbind has failed (e.g. no NUMA support); memory then falls
+  // back to first-touch placement.
+  std::atomic<bool> preferred{true};
+
+  void* do_allocate(size_t bytes, size_t alignment) override;
+  void do_deallocate(void*, size_t, size_t) override {}
+  bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+    return this == &other;
+  }
+
+ public:
+  explicit NodeMemoryResource(int node) : node(node) {}
+  bool IsPreferred() const { return preferred.load(std::memory_order_relaxed); }
+};
+
+class Placement {
+  struct ThreadRecord {
+    std::string role;
+    int cpu;  // -1 when not pinned.
+    int node;
+  };
+
+  struct RoleCpus {
+    std::vector<int> cpus;
+    std::atomic<unsigned> next{0};
+  };
+
+  // CPUs configured per thread role, handed out round-robin within a role.
+  inline static std::map<std::string, RoleCpus> role_cpus;
+  inline static std::mutex threads_mutex;
+  inline static std::map<int, ThreadRecord> threads;  // Keyed by tid.
+  // Node of the CPU this thread is pinned to; -1 when it is not pinned.
+  inline static thread_local int pinned_node = -1;
+  inline static std::mutex node_memory_mutex;
+  inline static std::map<int, NodeMemoryResource*> node_memory;
+
+ public:
+  // Gives threads of 'role' the CPUs in a list such as "0-3,8". Returns
+  // false (and leaves the role unpinned) if the list is malformed, repeats
+  // a CPU, names a CPU this process may not run on, or - when 'single' is
+  // set - names more than one CPU. Call before any thread of 'role' starts.
+  static bool Configure(const std::string& role, const char* cpu_list, bool single);
+
+  // Pins the calling thread to the next CPU configured for 'role', if any,
+  // and registers it for Dump().
+  static void PinCurrentThread(const char* role);
+  static void ForgetCurrentThread();
+  static int PinnedNode() { return pinned_node; }
+
+  // Memory preferring 'node', or the default heap for node -1.
+  static std::pmr::memory_resource* NodeMemory(int node);
+
+  // NUMA node of the CPU the caller is running on, or -1 if unknown.
+  static int CurrentNode();
+  // NUMA node holding the page at 'address', or -1 if unknown.
+  static int NodeOf(const void* address);
+
+  static void Dump(std::ostream& out);
+};
+
+#endif
@@ -0,0 +1,249 @@
+// Front-end for a sharded deployment. Clients connect to the router exactly
+// as they would to a single engine; every instrument is owned by one of the
+// engine shards (chosen by hashing its name), and each input is forwarded
+// to the owning shard. Cancels carry no instrument, so the router remembers
+// which shard every order ID was sent to.
+//
+// Each client gets its own connection to every shard it talks to, so the
+// order in which one client's inputs reach a shard is the order it sent
+// them. Each engine prints the output for its own instruments.
+
+#define _POSIX_C_SOURCE 200809L
+#define _GNU_SOURCE
+
+#include <signal.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <threads.h>
+#include <unistd.h>
+
+#include "io.h"
+
+#define MAX_SHARDS 64
+
+// Order ID -> owning shard + 1 (0 = unknown), as 64K lazily allocated pages
+// of 64K entries indexed by the high and low halves of the ID.
+#define OWNER_PAGE_BITS 16
+#define OWNER_PAGE_SIZE (1u << OWNER_PAGE_BITS)
+
+static _Atomic(_Atomic unsigned char *) owner_pages[OWNER_PAGE_SIZE];
+
+static char **shard_paths;
+static int shard_count;
+
+static int listenfd = -1;
+static char *socketpath = NULL;
+
+static _Atomic unsigned char *owner_page(uint32_t order_id, int create) {
+  _Atomic(_Atomic unsigned char *) *slot =
+      &owner_pages[order_id >> OWNER_PAGE_BITS];
+  _Atomic unsigned char *page = atomic_load(slot);
+  if (page || !create) {
+    return page;
+  }
+  _Atomic unsigned char *fresh = calloc(OWNER_PAGE_SIZE, 1);
+  if (!fresh) {
+    return NULL;
+  }
+  if (!atomic_compare_exchange_strong(slot, &page, fresh)) {
+    // Another client thread installed the page first.
+    free((void *)fresh);
+    return page;
+  }
+  return fresh;
+}
+
+static int record_owner(uint32_t order_id, int shard) {
+  _Atomic unsigned char *page = owner_page(order_id, 1);
+  if (!page) {
+    return -1;
+  }
+  atomic_store_explicit(&page[order_id & (OWNER_PAGE_SIZE - 1)],
+                        (unsigned char)(shard + 1), memory_order_release);
+  return 0;
+}
+
+// Returns -1 if the order was never seen; the caller lets a shard reject it.
+static int lookup_owner(uint32_t order_id) {
+  _Atomic unsigned char *page = owner_page(order_id, 0);
+  if (!page) {
+    return -1;
+  }
+  return (int)atomic_load_explicit(&page[order_id & (OWNER_PAGE_SIZE - 1)],
+                                   memory_order_acquire) -
+         1;
+}
+
+// FNV-1a over the (at most 8 character) instrument name.
+static int instrument_shard(const char *instrument) {
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < sizeof(((struct input *)0)->instrument) &&
+                     instrument[i] != '\0';
+       i++) {
+    hash = (hash ^ (unsigned char)instrument[i]) * 16777619u;
+  }
+  return (int)(hash % (uint32_t)shard_count);
+}
+
+static int connect_shard(int shard) {
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd == -1) {
+    perror("socket");
+    return -1;
+  }
+  struct sockaddr_un sockaddr = {.sun_family = AF_UNIX};
+  strncpy(sockaddr.sun_path, shard_paths[shard],
+          sizeof(sockaddr.sun_path) - 1);
+  if (connect(fd, (struct sockaddr *)&sockaddr, sizeof(sockaddr)) != 0) {
+    perror("connect");
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static int forward(int *shard_fds, int shard, const struct input *input) {
+  if (shard_fds[shard] == -1 &&
+      (shard_fds[shard] = connect_shard(shard)) == -1) {
+    return -1;
+  }
+  const char *data = (const char *)input;
+  size_t left = sizeof(*input);
+  while (left > 0) {
+    ssize_t sent = send(shard_fds[shard], data, left, MSG_NOSIGNAL);
+    if (sent == -1) {
+      perror("send");
+      return -1;
+    }
+    data += sent;
+    left -= (size_t)sent;
+  }
+  return 0;
+}
+
+static int client_thread(void *connptr) {
+  FILE *conn = connptr;
+  int shard_fds[MAX_SHARDS];
+  for (int i = 0; i < shard_count; i++) {
+    shard_fds[i] = -1;
+  }
+
+  struct input input;
+  while (fread_unlocked(&input, 1, sizeof(input), conn) == sizeof(input)) {
+    int ok = 0;
+    switch (input.type) {
+      case input_buy:
+      case input_sell: {
+        int shard = instrument_shard(input.instrument);
+        // Only remember shards that actually received the order.
+        ok = forward(shard_fds, shard, &input) == 0 &&
+             record_owner(input.order_id, shard) == 0;
+        break;
+      }
+      case input_cancel: {
+        int shard = lookup_owner(input.order_id);
+        ok = forward(shard_fds, shard == -1 ? 0 : shard, &input) == 0;
+        break;
+      }
+      default:
+        ok = 1;
+        for (int i = 0; i < shard_count && ok; i++) {
+          ok = forward(shard_fds, i, &input) == 0;
+        }
+        break;
+    }
+    if (!ok) {
+      fprintf(stderr, "Dropping client: failed to reach shard\n");
+      break;
+    }
+  }
+
+  for (int i = 0; i < shard_count; i++) {
+    if (shard_fds[i] != -1) {
+      close(shard_fds[i]);
+    }
+  }
+  fclose(conn);
+  return 0;
+}
+
+static void handle_exit_signal(int signum) {
+  (void)signum;
+  exit(0);
+}
+
+static void exit_cleanup(void) {
+  if (listenfd == -1) {
+    return;
+  }
+
+  close(listenfd);
+
+  if (socketpath) {
+    unlink(socketpath);
+  }
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 3 || argc - 2 > MAX_SHARDS) {
+    fprintf(stderr,
+            "Usage: %s <socket path> <shard socket path>... (at most %d "
+            "shards)\n",
+            argv[0], MAX_SHARDS);
+    return 1;
+  }
+
+  shard_paths = argv + 2;
+  shard_count = argc - 2;
+
+  socketpath = argv[1];
+  listenfd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listenfd == -1) {
+    perror("socket");
+    return 1;
+  }
+
+  {
+    struct sockaddr_un sockaddr = {.sun_family = AF_UNIX};
+    strncpy(sockaddr.sun_path, argv[1], sizeof(sockaddr.sun_path) - 1);
+    if (bind(listenfd, (struct sockaddr *)&sockaddr, sizeof(sockaddr)) !=
+        0) {
+      perror("bind");
+      return 1;
+    }
+  }
+
+  atexit(exit_cleanup);
+  signal(SIGINT, handle_exit_signal);
+  signal(SIGTERM, handle_exit_signal);
+
+  if (listen(listenfd, 8) != 0) {
+    perror("listen");
+    return 1;
+  }
+
+  while (1) {
+    int connfd = accept(listenfd, NULL, NULL);
+    if (connfd == -1) {
+      perror("accept");
+      return 1;
+    }
+    FILE *conn = fdopen(connfd, "r");
+    setvbuf(conn, NULL, _IOFBF, BUFSIZ);
+    thrd_t thread;
+    if (thrd_create(&thread, client_thread, conn) != thrd_success) {
+      fprintf(stderr, "Failed to create client thread\n");
+      fclose(conn);
+      continue;
+    }
+    thrd_detach(thread);
+  }
+
+  return 0;
+}
@@ -0,0 +1,49 @@
+#!/bin/bash
+# Runs the same orders through the engine in text mode and in binary mode,
+# decodes the binary output and checks both match with timestamps masked.
+dir=$(mktemp -d)
+trap 'kill $(jobs -p) 2>/dev/null; rm -rf $dir' EXIT
+
+cat > $dir/orders <<EOF2
+B 1 GOOG 50 10
+B 2 META 40 5
+S 3 ABCDEFGH 70 3
+S 4 GOOG 50 10
+B 5 ABCDEFGH 70 3
+C 2
+C 2
+C 99
+S 6 BABA 4294967295 4294967295
+B 7 BABA 1 1
+C 7
+P
+EOF2
+
+run() {
+  rm -f $dir/socket
+  ./engine $dir/socket "$@" > $dir/stdout 2>/dev/null &
+  local pid=$!
+  sleep .5
+  ./client $dir/socket < $dir/orders
+  sleep .5
+  kill $pid
+  wait $pid 2>/dev/null
+}
+
+# Keep event lines only (not the 'P' book dump) and drop both timestamps.
+mask() {
+  awk '(($1 == "B" || $1 == "S") && NF == 7) || ($1 == "E" && NF == 8) ||
+       ($1 == "X" && NF == 5) { NF -= 2; print }'
+}
+
+run
+mask < $dir/stdout > $dir/text
+run $dir/binary
+./decoder < $dir/binary | mask > $dir/decoded
+
+if diff $dir/text $dir/decoded; then
+  echo "PASS: $(wc -l < $dir/text) events match"
+else
+  echo "FAIL: decoded binary output differs from text output"
+  exit 1
+fi
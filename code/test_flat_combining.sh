@@ -0,0 +1,126 @@
+#!/bin/bash
+# Checks ENGINE_FLAT_COMBINING=1 against the default mutex mode: one client
+# must get identical events (timestamps masked), several clients racing on
+# one hot symbol must get exactly one event per order, and racing matches
+# and cancels must produce events consistent with the orders sent.
+dir=$(mktemp -d)
+trap 'kill $(jobs -p) 2>/dev/null; rm -rf $dir' EXIT
+
+# Equal sizes -> every order either rests or fully fills one resting order.
+for c in 1 2 3 4; do
+  awk -v c=$c 'BEGIN {
+    srand(c)
+    for (i = 0; i < 5000; i++) {
+      symbol = rand() < 0.9 ? "GOOG" : "META"
+      printf "%s %d %s 100 10\n", rand() < 0.5 ? "B" : "S", c * 100000 + i, symbol
+    }
+  }' > $dir/client$c
+done
+
+# Same shape with crossing prices, plus cancels aimed at any client's orders.
+for c in 5 6 7 8; do
+  awk -v c=$c 'BEGIN {
+    srand(c)
+    for (i = 0; i < 5000; i++) {
+      if (rand() < 0.25) {
+        printf "C %d\n", (5 + int(rand() * 4)) * 100000 + int(rand() * (i + 1))
+        continue
+      }
+      symbol = rand() < 0.9 ? "GOOG" : "META"
+      printf "%s %d %s %d 10\n", rand() < 0.5 ? "B" : "S", c * 100000 + i, symbol, 99 + int(rand() * 3)
+    }
+  }' > $dir/client$c
+done
+echo P > $dir/print
+
+run() {
+  rm -f $dir/socket
+  ./engine $dir/socket > $dir/stdout 2>/dev/null &
+  local pid=$!
+  sleep .5
+  local clients=""
+  for c in "$@"; do
+    ./client $dir/socket < $dir/client$c &
+    clients="$clients $!"
+  done
+  wait $clients
+  sleep .5
+  ./client $dir/socket < $dir/print
+  sleep .5
+  kill $pid
+  wait $pid 2>/dev/null
+}
+
+# Event lines only (not the 'P' book dump), timestamps dropped.
+mask() {
+  awk '(($1 == "B" || $1 == "S") && NF == 7) || ($1 == "E" && NF == 8) ||
+       ($1 == "X" && NF == 5) { NF -= 2; print }' $dir/stdout
+}
+
+status=0
+
+run 1
+mask > $dir/mutex
+ENGINE_FLAT_COMBINING=1 run 1
+mask > $dir/combining
+if diff -q $dir/mutex $dir/combining > /dev/null; then
+  echo "PASS: single client output matches mutex mode"
+else
+  echo "FAIL: single client output differs from mutex mode"
+  status=1
+fi
+
+ENGINE_FLAT_COMBINING=1 run 1 2 3 4
+events=$(mask | wc -l)
+if [ $events -eq 20000 ]; then
+  echo "PASS: 4 clients got $events events"
+else
+  echo "FAIL: 4 clients got $events events, expected 20000"
+  status=1
+fi
+
+# Replays the events against the orders sent: every order is added once or
+# fully fills one resting order, executions cross at the resting price,
+# accepted cancels hit resting orders, and the final book dump holds exactly
+# the orders left resting.
+ENGINE_FLAT_COMBINING=1 run 5 6 7 8
+errors=$(cat $dir/client5 $dir/client6 $dir/client7 $dir/client8 | awk '
+  FNR == NR {
+    if ($1 != "C") { side[$2] = $1; symbol[$2] = $3; price[$2] = $4 }
+    next
+  }
+  function bad(why) { print why ": " $0; errors++ }
+  /^\[Order Book\]/ { in_book = 1; next }
+  /^=+$/ { in_book = 0; next }
+  in_book && NF == 5 { dumped[$2] = 1; next }
+  ($1 == "B" || $1 == "S") && NF == 7 {
+    if (($2 in added) || ($2 in filled)) bad("order seen twice")
+    if ($1 != side[$2] || $3 != symbol[$2] || $4 != price[$2]) bad("add differs from order")
+    added[$2] = 1; resting[$2] = 1
+  }
+  $1 == "E" && NF == 8 {
+    if (!($2 in resting)) bad("execution against non-resting order")
+    if (($3 in added) || ($3 in filled)) bad("order seen twice")
+    if (symbol[$2] != symbol[$3] || side[$2] == side[$3]) bad("execution across books or sides")
+    if ($5 != price[$2] || $4 != 1 || $6 != 10) bad("execution fields wrong")
+    if (side[$3] == "B" ? price[$3] < price[$2] : price[$3] > price[$2]) bad("execution does not cross")
+    delete resting[$2]; filled[$3] = 1
+  }
+  $1 == "X" && NF == 5 && $3 == "A" {
+    if (!($2 in resting)) bad("accepted cancel of non-resting order")
+    delete resting[$2]
+  }
+  END {
+    for (id in side) if (!(id in added) && !(id in filled)) { print "no event for order " id; errors++ }
+    for (id in resting) if (!(id in dumped)) { print "resting order missing from book " id; errors++ }
+    for (id in dumped) if (!(id in resting)) { print "unexpected order in book " id; errors++ }
+    print errors + 0
+  }' - $dir/stdout | tail -1)
+if [ "$errors" = "0" ]; then
+  echo "PASS: racing matches and cancels are consistent"
+else
+  echo "FAIL: $errors inconsistencies between racing matches and cancels"
+  status=1
+fi
+
+exit $status
@@ -0,0 +1,87 @@
+#!/bin/bash
+# Runs the same orders through one engine and through ./router with several
+# shards, and checks the union of the shard outputs matches the single
+# engine's output (sorted, timestamps masked). Covers cancels routed by
+# order ID, unknown IDs rejected by shard 0, and 'P' reaching every shard.
+shards=${1:-3}
+dir=$(mktemp -d)
+trap 'kill $(jobs -p) 2>/dev/null; rm -rf $dir' EXIT
+
+cat > $dir/orders <<EOF2
+B 1 GOOG 50 10
+B 2 META 40 5
+S 3 BABA 70 3
+S 4 AAPL 20 8
+B 5 MSFT 30 2
+B 6 NVDA 60 4
+S 7 GOOG 50 10
+B 8 BABA 70 5
+S 9 AAPL 21 1
+S 10 META 30 7
+C 4
+C 6
+C 3
+C 1
+C 12345
+C 99
+B 11 AMZN 5 5
+S 12 AMZN 5 5
+C 12
+B 13 TSLA 10 1
+C 13
+C 13
+P
+EOF2
+
+start_engine() {
+  rm -f $1
+  ./engine $1 > $2 2>/dev/null &
+}
+
+# Events plus the book dump contents; dump separators are per process.
+mask() {
+  awk '(($1 == "B" || $1 == "S") && NF == 7) || ($1 == "E" && NF == 8) ||
+       ($1 == "X" && NF == 5) { NF -= 2; print; next }
+       !/^=+$/ && !/^\[Order Book\]$/ { print }' "$@" | sort
+}
+
+status=0
+
+start_engine $dir/single.sock $dir/single.out
+sleep .5
+./client $dir/single.sock < $dir/orders
+sleep .5
+kill %1
+wait 2>/dev/null
+mask $dir/single.out > $dir/expected
+
+paths=""
+for s in $(seq 1 $shards); do
+  start_engine $dir/shard$s.sock $dir/shard$s.out
+  paths="$paths $dir/shard$s.sock"
+done
+sleep .5
+./router $dir/router.sock $paths &
+sleep .2
+./client $dir/router.sock < $dir/orders
+sleep .5
+kill $(jobs -p)
+wait 2>/dev/null
+mask $dir/shard*.out > $dir/sharded
+
+if diff $dir/expected $dir/sharded; then
+  echo "PASS: $shards shards match a single engine ($(wc -l < $dir/expected) lines)"
+else
+  echo "FAIL: sharded output differs from a single engine"
+  status=1
+fi
+
+dumps=$(cat $dir/shard*.out | grep -c '^\[Order Book\]$')
+if [ $dumps -eq $shards ]; then
+  echo "PASS: 'P' reached all $shards shards"
+else
+  echo "FAIL: 'P' reached $dumps of $shards shards"
+  status=1
+fi
+
+exit $status